@@ -12,8 +12,22 @@
 
 import urwid
 import serial
-from collections import deque
+from collections import OrderedDict, deque
+from array import array
+from bisect import bisect_left, bisect_right
+from concurrent.futures import ProcessPoolExecutor
+from datetime import date
+from itertools import accumulate, chain, compress, count, repeat
+import math
+import operator
+import os
+import queue
+import re
+import struct
+import sys
+import threading
 import time
+import traceback
 
 
 class Scale:
@@ -115,6 +129,21 @@ class Scale:
         else:
             return ("red", "status:" + self.ecr_status.decode("utf-8"))
 
+    @property
+    def status(self):
+        """
+        Return ECR status as an integer, e.g. 10 for b"10", or -1 if unknown.
+        Status bytes are bit fields in 0x30-0x3F, so fault combinations
+        such as b"1:" are not decimal.  These map to 100 + 16*hi + lo of
+        the low nibbles, which can't collide with decimal codes.
+        """
+        if self.ecr_status is None:
+            return -1
+        hi, lo = self.ecr_status[0] & 0xF, self.ecr_status[1] & 0xF
+        if hi <= 9 and lo <= 9:
+            return hi * 10 + lo
+        return 100 + hi * 16 + lo
+
     @property
     def weight_is_valid(self):
         """Return True if most recent poll() returned a valid weight."""
@@ -234,8 +263,33 @@ jgs \""--..__                              __..--""/
             align="center",
         )
 
+        # history view: chart + paging buttons
+        self._histtitle = urwid.Text("", align="center")
+        self._histchart = urwid.Text("")
+        h = urwid.Pile([self._histtitle, self._histchart])
+        h = urwid.Padding(h, align="center", width=80)
+        self.historybody = urwid.Filler(h)
+        buttons = [
+            urwid.Button(label, on_press=self.handle_button, user_data=key)
+            for label, key in (("<", "left"), ("day/week", "w"), (">", "right"))
+        ]
+        buttons.append(urwid.Button("close", on_press=self.handle_button, user_data="h"))
+        self.historyfoot = urwid.Columns(buttons, 1)
+
+        # online/offline footers get a button to open the history view
+        self.onlinefoot, self.offlinefoot = [
+            urwid.Columns(
+                [w, (13, urwid.Button("history", self.handle_button, "h"))], 1
+            )
+            for w in (self.pbar, self.footmsg)
+        ]
+
+        self.view = (self.meterbody, self.offlinefoot)
+        self.history_shown = False
+        self.keyhandler = None
+
         self.layout = urwid.Frame(
-            header=self.header, body=self.meterbody, footer=self.footmsg
+            header=self.header, body=self.meterbody, footer=self.offlinefoot
         )
 
         self.main_loop = urwid.MainLoop(
@@ -249,6 +303,12 @@ jgs \""--..__                              __..--""/
         """
         if key == "Q" or key == "q":
             raise urwid.ExitMainLoop()
+        elif self.keyhandler:
+            self.keyhandler(key)
+
+    def handle_button(self, _button, key):
+        """Pass touchscreen button presses on as keys"""
+        self.handle_input(key)
 
     def tick_wrap(self, _loop, _data):
         """
@@ -257,13 +317,15 @@ jgs \""--..__                              __..--""/
         self.ticker()
         _loop.set_alarm_in(self.tick_period, self.tick_wrap)
 
-    def run(self, ticker, tick_period):
+    def run(self, ticker, tick_period, keyhandler=None):
         """
-        Register ticker callable, to run every tick_period seconds.
+        Register ticker callable, to run every tick_period seconds,
+        and keyhandler callable, to receive keys other than q.
         Start urwid's main loop.
         This method does not return until loop exits (press q).
         """
         self.ticker = ticker
+        self.keyhandler = keyhandler
         self.tick_period = tick_period
         self.main_loop.set_alarm_in(0, self.tick_wrap)
         self.main_loop.run()
@@ -307,19 +369,1181 @@ jgs \""--..__                              __..--""/
 
     def online(self):
         """Set online display mode (show background + footer progress bar)"""
-        self.layout.body = self.background
-        self.layout.footer = self.pbar
+        self.view = (self.background, self.onlinefoot)
+        if not self.history_shown:
+            self.layout.body, self.layout.footer = self.view
 
     def offline(self):
         """Set offline display mode (show meter + footer message)"""
-        self.layout.body = self.meterbody
-        self.layout.footer = self.footmsg
+        self.view = (self.meterbody, self.offlinefoot)
+        if not self.history_shown:
+            self.layout.body, self.layout.footer = self.view
+
+    def history(self, title, lines):
+        """Show history view with page title and chart lines"""
+        self._histtitle.set_text(("green", title))
+        self._histchart.set_text("\n".join(lines))
+        self.history_shown = True
+        self.layout.body = self.historybody
+        self.layout.footer = self.historyfoot
+
+    def history_close(self):
+        """Leave history view, restoring online or offline display mode"""
+        self.history_shown = False
+        self.layout.body, self.layout.footer = self.view
 
     def progress(self, value):
         """Update progress bar value (pot contents in mL)"""
         self.pbar.set_completion(value)
 
 
+class Journal:
+    """
+    Append-only journal of state transitions.
+
+    Each record is a packed (timestamp, code) pair, where the code holds
+    a channel number in its high nibble and a state in its low nibble.
+    Pot states (unknown/brewing/ready/empty) and online states
+    (online/offline) are kept as separate channels, each with its own
+    time index.  The down state, which each channel has, marks time
+    brewcop was not running so it isn't counted as the state before
+    shutdown.  Per-day
+    summary blocks hold cumulative seconds spent in each state, so the
+    whole days of an interval query are answered by a subtraction and
+    only the partial days at either end are walked record by record.
+
+    append() only queues the record.  A writer thread drains everything
+    queued since its last write and commits it with one write + fsync
+    (group commit), so the tick never waits on storage.
+    """
+
+    path_journal = os.path.expanduser("~/.brewcop/journal")
+
+    channels = (
+        ("unknown", "brewing", "ready", "empty", "down"),
+        ("online", "offline", "down"),
+    )
+    channel_names = ("pot", "scale")
+    record = struct.Struct("<dB")
+
+    def __init__(self, path=None):
+        self.path = path or self.path_journal
+        self.times = [array("d"), array("d")]
+        self.codes = [array("B"), array("B")]
+        self.entered = {}
+        self.first_day = None
+        self.cum = [[array("d") for s in states] for states in self.channels]
+        self.load()
+
+        self.queue = queue.Queue()
+        self.writer = threading.Thread(target=self.write_loop, daemon=True)
+        self.writer.start()
+
+    def load(self):
+        """
+        Replay an existing journal file.  A torn final record, left by
+        an unclean exit, is truncated away so new records stay aligned.
+        """
+        try:
+            with open(self.path, "rb") as f:
+                buf = f.read()
+        except FileNotFoundError:
+            os.makedirs(os.path.dirname(self.path), exist_ok=True)
+            return
+        end = len(buf) - len(buf) % self.record.size
+        if end < len(buf):
+            os.truncate(self.path, end)
+        for t, code in self.record.iter_unpack(buf[:end]):
+            c, s = code >> 4, code & 0xF
+            if c < len(self.channels) and s < len(self.channels[c]):
+                self.index(t, c, s)
+
+    def write_loop(self):
+        """Writer thread: commit queued records in batches"""
+        with open(self.path, "ab") as f:
+            while True:
+                batch = [self.queue.get()]
+                while True:
+                    try:
+                        batch.append(self.queue.get_nowait())
+                    except queue.Empty:
+                        break
+                done = None in batch
+                f.write(b"".join(rec for rec in batch if rec is not None))
+                f.flush()
+                os.fsync(f.fileno())
+                if done:
+                    return
+
+    def close(self):
+        """Flush pending records and stop the writer thread"""
+        self.queue.put(None)
+        self.writer.join()
+
+    def append(self, state, t=None):
+        """Record entry to state at time t (default now), in each channel with it"""
+        if t is None:
+            t = time.time()
+        for c, states in enumerate(self.channels):
+            if state not in states:
+                continue
+            s = states.index(state)
+            codes = self.codes[c]
+            if len(codes) > 0 and codes[-1] == s:
+                continue
+            self.index(t, c, s)
+            self.queue.put(self.record.pack(t, c << 4 | s))
+
+    def lookup(self, state, channel=None):
+        """
+        Return (channel, state number) of state, in the named channel or
+        else the first channel with it.  Raise ValueError if unknown.
+        """
+        for c, states in enumerate(self.channels):
+            if channel in (None, self.channel_names[c]) and state in states:
+                return (c, states.index(state))
+        raise ValueError("unknown state '{}'".format(state))
+
+    def recover(self, t):
+        """
+        If brewcop did not shut down cleanly, the journal doesn't end in
+        the down state.  Record down at t, the last time brewcop is known
+        to have been running, or at the last record if that is later.
+        """
+        last = [times[-1] for times in self.times if len(times) > 0]
+        if len(last) > 0:
+            self.append("down", max([t] + last))
+
+    def day(self, t):
+        """Return local day number containing time t"""
+        return date.fromtimestamp(t).toordinal()
+
+    def daystart(self, d):
+        """Return time of local midnight starting day number d"""
+        return time.mktime(date.fromordinal(d).timetuple())
+
+    def index(self, t, c, s):
+        """
+        Add a record of state s to channel c's time index.  This closes
+        the interval spent in the channel's previous state, which is
+        credited to the summary blocks of the day(s) it covers.
+        """
+        times, codes = self.times[c], self.codes[c]
+        if self.first_day is None:
+            self.first_day = self.day(t)
+        if len(times) > 0:
+            a, d = times[-1], self.day(times[-1])
+            while a < t:
+                b = min(t, self.daystart(d + 1))
+                self.credit(d, c, codes[-1], b - a)
+                a, d = b, d + 1
+        times.append(t)
+        codes.append(s)
+        self.entered[(c, s)] = t
+
+    def credit(self, d, c, s, secs):
+        """Add secs in channel c state s to day d's cumulative summary"""
+        i = d - self.first_day
+        for cum in chain.from_iterable(self.cum):
+            while len(cum) <= i:
+                cum.append(cum[-1] if len(cum) > 0 else 0.0)
+        cum = self.cum[c][s]
+        for j in range(i, len(cum)):
+            cum[j] += secs
+
+    def walk(self, c, s, a, b):
+        """Sum time in channel c state s over [a, b) using the record index"""
+        times, codes = self.times[c], self.codes[c]
+        b = min(b, time.time())
+        i = bisect_right(times, a) - 1
+        total = 0.0
+        while a < b:
+            end = times[i + 1] if i + 1 < len(times) else b
+            end = min(end, b)
+            if i >= 0 and codes[i] == s:
+                total += end - a
+            a, i = max(a, end), i + 1
+        return total
+
+    def duration(self, state, t0, t1, channel=None):
+        """Return seconds spent in state over the interval [t0, t1)"""
+        c, s = self.lookup(state, channel)
+        times = self.times[c]
+        if len(times) == 0 or t1 <= t0:
+            return 0.0
+        lo = max(self.day(t0) + 1, self.first_day)
+        hi = min(self.day(t1), self.day(times[-1]))
+        if lo >= hi:
+            return self.walk(c, s, t0, t1)
+        cum = self.cum[c][s]
+        total = cum[hi - 1 - self.first_day]
+        if lo > self.first_day:
+            total -= cum[lo - 1 - self.first_day]
+        total += self.walk(c, s, t0, self.daystart(lo))
+        total += self.walk(c, s, self.daystart(hi), t1)
+        return total
+
+    def spans(self, c, s, t0, t1):
+        """Yield unclipped (start, end) spans in channel c state s overlapping [t0, t1)"""
+        times, codes = self.times[c], self.codes[c]
+        now = time.time()
+        i = max(bisect_right(times, t0) - 1, 0)
+        while i < len(times) and times[i] < t1:
+            if codes[i] == s:
+                end = times[i + 1] if i + 1 < len(times) else now
+                if end > t0:
+                    yield (times[i], end)
+            i += 1
+
+    def intervals(self, state, t0, t1, channel=None):
+        """Return list of (start, end) spent in state, clipped to [t0, t1)"""
+        t1 = min(t1, time.time())
+        c, s = self.lookup(state, channel)
+        return [(max(a, t0), min(b, t1)) for a, b in self.spans(c, s, t0, t1)]
+
+    def stale(self, t0, t1, stale_thresh):
+        """Return seconds over [t0, t1) that ready coffee was stale"""
+        total = 0.0
+        for a, b in self.spans(*self.lookup("ready"), t0, t1):
+            a = max(a + stale_thresh, t0)
+            b = min(b, t1)
+            if b > a:
+                total += b - a
+        return total
+
+    def last(self, state, channel=None):
+        """Return time state was most recently entered, or None"""
+        return self.entered.get(self.lookup(state, channel))
+
+
+class Chunk:
+    """
+    A run of scale samples stored as parallel column arrays, with min/max
+    statistics per column.  On disk, a header holding the sample count and
+    statistics is followed by each column's raw array, so the statistics
+    can be read without touching the samples.
+
+    The columns are followed by a rollup of weight per rollup_step
+    seconds: a row count, then (time, count, sum, min, max) columns.
+    History views read this instead of decoding samples.
+
+    Last is a status index: the number of distinct status values, then
+    for each, a (status, n) header, its n weights sorted ascending, and
+    their n + 1 prefix sums.  Queries use it to aggregate a weight range
+    for a status by bisection, without touching the samples.
+
+    The file ends with the chunk's sources: for a chunk made by merging
+    others, a (start, count, name length) entry and name for each chunk
+    it replaced, and for the chunks they replaced, followed by the byte
+    length of the entries.  A sealed chunk has none.
+    """
+
+    columns = (("time", "d"), ("weight", "f"), ("status", "h"))
+    header = struct.Struct("<Iddddhh")
+
+    rollup_columns = (("time", "d"), ("count", "I"), ("sum", "d"), ("min", "f"), ("max", "f"))
+    rollup_header = struct.Struct("<I")
+    rollup_step = 60
+
+    index_header = struct.Struct("<I")
+    index_entry = struct.Struct("<hI")
+
+    source_entry = struct.Struct("<IIH")
+    source_footer = struct.Struct("<I")
+
+    def __init__(self, path=None):
+        self.path = path
+        self.count = 0
+        self.stats = {name: (math.inf, -math.inf) for name, t in self.columns}
+        self.cols = {name: array(t) for name, t in self.columns}
+        self.rollups = None
+        self.statusidx = None
+        self.sources = []
+
+    @classmethod
+    def open(cls, path):
+        """Read a chunk header and sources, leaving the columns on disk"""
+        chunk = cls(path)
+        chunk.cols = None
+        with open(path, "rb") as f:
+            hdr = cls.header.unpack(f.read(cls.header.size))
+            f.seek(-cls.source_footer.size, 2)
+            (size,) = cls.source_footer.unpack(f.read(cls.source_footer.size))
+            f.seek(-cls.source_footer.size - size, 2)
+            buf = f.read(size)
+        chunk.count = hdr[0]
+        for i, (name, t) in enumerate(cls.columns):
+            chunk.stats[name] = hdr[1 + 2 * i : 3 + 2 * i]
+        offset = 0
+        while offset < len(buf):
+            start, count, n = cls.source_entry.unpack_from(buf, offset)
+            offset += cls.source_entry.size
+            name = buf[offset : offset + n].decode()
+            offset += n
+            chunk.sources.append((name, start, count))
+        return chunk
+
+    def append(self, *values):
+        """Append one sample, updating statistics with the stored values"""
+        for (name, t), value in zip(self.columns, values):
+            col = self.cols[name]
+            col.append(value)
+            mn, mx = self.stats[name]
+            self.stats[name] = (min(mn, col[-1]), max(mx, col[-1]))
+        self.count += 1
+
+    def frozen(self):
+        """Return an immutable copy of the samples appended so far"""
+        count = self.count
+        chunk = Chunk(self.path)
+        chunk.count = count
+        chunk.stats = dict(self.stats)
+        chunk.cols = {name: col[:count] for name, col in self.load().items()}
+        return chunk
+
+    def load(self):
+        """Return the columns, reading them from disk if not in memory"""
+        cols = self.cols
+        if cols is not None:
+            return cols
+        cols = {}
+        try:
+            f = open(self.path, "rb")
+        except FileNotFoundError:
+            return self.load_replacement()
+        with f:
+            f.seek(self.header.size)
+            for name, t in self.columns:
+                cols[name] = array(t)
+                cols[name].fromfile(f, self.count)
+        return cols
+
+    def load_replacement(self):
+        """
+        A reader in another process isn't protected by the compacting
+        process's epochs, so a chunk in its snapshot may have been merged
+        and unlinked.  Return this chunk's samples from the merged chunk
+        ("tmin.tmax.chunk") that lists it as a source.
+        """
+        dirname, basename = os.path.split(self.path)
+        for attempt in range(3):
+            for name in os.listdir(dirname):
+                if name.count(".") != 4 or not name.endswith(".chunk"):
+                    continue
+                try:
+                    merged = Chunk.open(os.path.join(dirname, name))
+                    for source, start, count in merged.sources:
+                        if source == basename:
+                            cols = merged.load()
+                            end = start + count
+                            return {k: col[start:end] for k, col in cols.items()}
+                except FileNotFoundError:
+                    continue
+        raise FileNotFoundError(self.path)
+
+    def rollup(self):
+        """
+        Return the weight rollup as a dict of columns.  It is read from
+        the chunk file, or computed from the samples if not in memory or
+        on disk, and kept for next time.
+        """
+        rollups = self.rollups
+        if rollups is not None:
+            return rollups
+        if self.cols is None:
+            rollups = self.read_rollup()
+        if rollups is None:
+            rollups = self.compute_rollup(self.load())
+        self.rollups = rollups
+        return rollups
+
+    def rollup_offset(self):
+        """Return file offset of the rollup section"""
+        offset = self.header.size
+        for name, t in self.columns:
+            offset += array(t).itemsize * self.count
+        return offset
+
+    def read_rollup(self):
+        """Read the rollup from the chunk file, or return None if absent"""
+        try:
+            f = open(self.path, "rb")
+        except FileNotFoundError:
+            return None
+        with f:
+            f.seek(self.rollup_offset())
+            buf = f.read(self.rollup_header.size)
+            if len(buf) < self.rollup_header.size:
+                return None
+            (rows,) = self.rollup_header.unpack(buf)
+            rollups = {}
+            for name, t in self.rollup_columns:
+                rollups[name] = array(t)
+                rollups[name].fromfile(f, rows)
+        return rollups
+
+    def compute_rollup(self, cols):
+        """Compute the rollup from sample columns"""
+        times, weights = cols["time"], cols["weight"]
+        rollups = {name: array(t) for name, t in self.rollup_columns}
+        if len(times) == 0:
+            return rollups
+        step = self.rollup_step
+        start = times[0] // step * step
+        lo = 0
+        while lo < len(times):
+            start += step
+            hi = bisect_left(times, start, lo)
+            if hi > lo:
+                part = weights[lo:hi]
+                rollups["time"].append(start - step)
+                rollups["count"].append(hi - lo)
+                rollups["sum"].append(sum(part))
+                rollups["min"].append(min(part))
+                rollups["max"].append(max(part))
+            lo = hi
+        return rollups
+
+    def status_index(self):
+        """
+        Return the status index as {status: (sorted weights, prefix sums)}.
+        It is read from the chunk file, or computed from the samples if
+        not in memory or on disk, and kept for next time.
+        """
+        statusidx = self.statusidx
+        if statusidx is not None:
+            return statusidx
+        if self.cols is None:
+            statusidx = self.read_status_index()
+        if statusidx is None:
+            statusidx = self.compute_status_index(self.load())
+        self.statusidx = statusidx
+        return statusidx
+
+    def read_status_index(self):
+        """Read the status index from the chunk file, or None if absent"""
+        try:
+            f = open(self.path, "rb")
+        except FileNotFoundError:
+            return None
+        with f:
+            f.seek(self.rollup_offset())
+            buf = f.read(self.rollup_header.size)
+            if len(buf) < self.rollup_header.size:
+                return None
+            (rows,) = self.rollup_header.unpack(buf)
+            f.seek(rows * sum(array(t).itemsize for n, t in self.rollup_columns), 1)
+            buf = f.read(self.index_header.size)
+            if len(buf) < self.index_header.size:
+                return None
+            (values,) = self.index_header.unpack(buf)
+            statusidx = {}
+            for i in range(values):
+                status, n = self.index_entry.unpack(f.read(self.index_entry.size))
+                weights, sums = array("f"), array("d")
+                weights.fromfile(f, n)
+                sums.fromfile(f, n + 1)
+                statusidx[status] = (weights, sums)
+        return statusidx
+
+    def compute_status_index(self, cols):
+        """Compute the status index from sample columns"""
+        groups = {}
+        for status, weight in zip(cols["status"], cols["weight"]):
+            groups.setdefault(status, []).append(weight)
+        statusidx = {}
+        for status, weights in groups.items():
+            weights.sort()
+            sums = array("d", accumulate(weights, initial=0.0))
+            statusidx[status] = (array("f", weights), sums)
+        return statusidx
+
+    def summary(self):
+        """Return [count, sum, min, max] of weight over the whole chunk"""
+        r = self.rollup()
+        return [sum(r["count"]), sum(r["sum"]), min(r["min"]), max(r["max"])]
+
+    def write(self):
+        """
+        Write chunk, its rollup, and its status index to disk, and drop
+        the in-memory columns
+        """
+        hdr = [self.count]
+        for name, t in self.columns:
+            hdr += self.stats[name]
+        rollups = self.rollup()
+        statusidx = self.status_index()
+        tmp = self.path + ".tmp"
+        with open(tmp, "wb") as f:
+            f.write(self.header.pack(*hdr))
+            for name, t in self.columns:
+                self.cols[name].tofile(f)
+            f.write(self.rollup_header.pack(len(rollups["time"])))
+            for name, t in self.rollup_columns:
+                rollups[name].tofile(f)
+            f.write(self.index_header.pack(len(statusidx)))
+            for status, (weights, sums) in statusidx.items():
+                f.write(self.index_entry.pack(status, len(weights)))
+                weights.tofile(f)
+                sums.tofile(f)
+            size = 0
+            for name, start, count in self.sources:
+                name = name.encode()
+                f.write(self.source_entry.pack(start, count, len(name)) + name)
+                size += self.source_entry.size + len(name)
+            f.write(self.source_footer.pack(size))
+            f.flush()
+            os.fsync(f.fileno())
+        os.rename(tmp, self.path)
+        self.cols = None
+
+
+class Epochs:
+    """
+    Epoch-based reclamation of retired chunks.
+
+    Readers pin the current epoch while they hold a snapshot.  Something
+    retired in epoch e is freed only once every pinned epoch is later
+    than e, and at least grace seconds have passed, which covers readers
+    in other processes (query and export commands).  Pinning is a dict
+    insert, atomic under the GIL, so readers never take a lock.  Only
+    the compactor thread retires and reclaims.
+    """
+
+    def __init__(self, grace=300):
+        self.grace = grace
+        self.epoch = 0
+        self.pins = {}
+        self.tickets = count()
+        self.retired = []
+
+    def pin(self):
+        """Pin the current epoch, returning a ticket for unpin()"""
+        ticket = next(self.tickets)
+        self.pins[ticket] = self.epoch
+        return ticket
+
+    def unpin(self, ticket):
+        """Release a pinned epoch"""
+        del self.pins[ticket]
+
+    def retire(self, free):
+        """
+        Schedule free() once current readers are done, and advance the
+        epoch.  Call after publishing the manifest that drops the object.
+        """
+        self.retired.append((self.epoch, time.time(), free))
+        self.epoch += 1
+
+    def reclaim(self):
+        """Free retired objects that no reader can still reference"""
+        oldest = min(list(self.pins.values()), default=self.epoch)
+        now = time.time()
+        keep = []
+        for epoch, t, free in self.retired:
+            if epoch < oldest and now - t >= self.grace:
+                free()
+            else:
+                keep.append((epoch, t, free))
+        self.retired = keep
+
+
+class Snapshot:
+    """
+    Pinned view of a sample store's chunks, for use as a context
+    manager.  The set of chunks is fixed: chunks it references are not
+    reclaimed until it exits, and samples appended after it was taken
+    are not seen.  The Chunk objects are shared with the store, though.
+    The writer thread drops a sealed chunk's in-memory cols once it is
+    on disk, and rollups and status indexes are cached on chunks as
+    they are read, so read chunk.cols at most once, or use load().
+    ends holds the end time of each chunk but the last, for bisection.
+    """
+
+    def __init__(self, store):
+        self.store = store
+
+    def __enter__(self):
+        self.ticket = self.store.epochs.pin()
+        sealed, self.ends, active = self.store.manifest
+        self.chunks = sealed + (active.frozen(),)
+        return self
+
+    def __exit__(self, *exc):
+        self.store.epochs.unpin(self.ticket)
+
+
+class SampleStore:
+    """
+    Store scale samples in chunks of chunk_size samples.
+
+    Samples are appended to an in-memory active chunk.  When it fills,
+    it is sealed and handed to a writer thread, so the tick never waits
+    on storage.  Sealed chunks on disk are known by their headers only
+    until a query needs their columns.
+
+    The set of chunks is an immutable manifest (sealed chunks, their end
+    times, active chunk) which writers replace with a single assignment.  Readers
+    take a Snapshot and never block the appender or the compactor.
+    Writers serialize only the brief manifest swap on publish_lock.
+
+    If compact is True, this store owns the directory: a compactor
+    thread merges undersized chunks (e.g. sealed at shutdown) every
+    compact_period seconds and deletes the ones it replaces.
+    """
+
+    path_samples = os.path.expanduser("~/.brewcop/samples")
+
+    """30 minutes of samples at 2 Hz"""
+    chunk_size = 3600
+
+    """
+    Chunks never span a slot_period boundary, so a chunk falls within
+    one hour or day for queries grouped that way.
+    """
+    slot_period = 1800
+
+    compact_period = 60
+
+    def __init__(self, path=None, compact=False):
+        self.path = path or self.path_samples
+        os.makedirs(self.path, exist_ok=True)
+        self.active = Chunk()
+        sealed = self.load(compact)
+        ends = tuple(c.stats["time"][1] for c in sealed)
+        self.manifest = (sealed, ends, self.active)
+        self.epochs = Epochs()
+        self.publish_lock = threading.Lock()
+
+        self.queue = queue.Queue()
+        self.writer = threading.Thread(target=self.write_loop, daemon=True)
+        self.writer.start()
+
+        self.stopping = threading.Event()
+        self.compactor = None
+        if compact:
+            self.compactor = threading.Thread(target=self.compact_loop, daemon=True)
+            self.compactor.start()
+
+    def load(self, owner):
+        """
+        Read chunk headers.  A chunk listed among the sources of another
+        was replaced by compaction before it could be deleted.  Skip it,
+        and delete it if we own the directory.  Skip a chunk that another
+        process's compactor removed since it was listed.
+        """
+        chunks = []
+        for name in os.listdir(self.path):
+            if name.endswith(".chunk"):
+                try:
+                    chunks.append(Chunk.open(os.path.join(self.path, name)))
+                except FileNotFoundError:
+                    pass
+        replaced = {name for c in chunks for name, start, count in c.sources}
+        chunks.sort(key=lambda c: c.stats["time"])
+        result = []
+        for chunk in chunks:
+            if os.path.basename(chunk.path) in replaced:
+                if owner:
+                    os.unlink(chunk.path)
+            else:
+                result.append(chunk)
+        return tuple(result)
+
+    def write_loop(self):
+        """Writer thread: write sealed chunks to disk"""
+        while True:
+            chunk = self.queue.get()
+            if chunk is None:
+                return
+            chunk.write()
+
+    def compact_loop(self):
+        """Compactor thread: compact and reclaim periodically"""
+        while not self.stopping.wait(self.compact_period):
+            self.compact()
+            self.epochs.reclaim()
+
+    def close(self):
+        """Stop the compactor, seal the active chunk, and wait for writes"""
+        self.stopping.set()
+        if self.compactor:
+            self.compactor.join()
+        self.seal()
+        self.queue.put(None)
+        self.writer.join()
+
+    def append(self, t, weight, status):
+        """Record a scale sample"""
+        if self.active.count > 0 and self.slot(t) != self.slot(self.active):
+            self.seal()
+        self.active.append(t, weight, status)
+        if self.active.count >= self.chunk_size:
+            self.seal()
+
+    def seal(self):
+        """Retire the active chunk to the writer thread and start a new one"""
+        chunk = self.active
+        if chunk.count == 0:
+            return
+        name = "{:.6f}.chunk".format(chunk.stats["time"][0])
+        chunk.path = os.path.join(self.path, name)
+        with self.publish_lock:
+            sealed, ends, active = self.manifest
+            self.active = Chunk()
+            self.manifest = (
+                sealed + (chunk,),
+                ends + (chunk.stats["time"][1],),
+                self.active,
+            )
+        self.queue.put(chunk)
+
+    def last_time(self):
+        """Return time of the last sample on disk, or 0 if none"""
+        sealed, ends, active = self.manifest
+        if len(ends) == 0:
+            return 0
+        return ends[-1]
+
+    def snapshot(self):
+        """Return a Snapshot of the store"""
+        return Snapshot(self)
+
+    def rollup(self, t0, t1, nbins):
+        """
+        Return nbins [count, sum, min, max] weight aggregates evenly
+        dividing [t0, t1), without decoding samples.  Chunks are found by
+        bisecting the manifest's chunk end times.  A chunk that
+        falls within one bin contributes its summary; others contribute
+        their rollup rows.
+        """
+        width = (t1 - t0) / nbins
+        bins = [[0, 0.0, math.inf, -math.inf] for i in range(nbins)]
+        with self.snapshot() as snap:
+            i = bisect_left(snap.ends, t0)
+            for chunk in snap.chunks[i:]:
+                if chunk.count == 0:
+                    continue
+                lo, hi = chunk.stats["time"]
+                if lo >= t1:
+                    break
+                a, b = int((lo - t0) // width), int((hi - t0) // width)
+                if a == b:
+                    keys, rows = [a], [chunk.summary()]
+                else:
+                    r = chunk.rollup()
+                    keys = [int((t - t0) // width) for t in r["time"]]
+                    rows = zip(r["count"], r["sum"], r["min"], r["max"])
+                for k, (count, total, mn, mx) in zip(keys, rows):
+                    if 0 <= k < nbins:
+                        agg = bins[k]
+                        agg[0] += count
+                        agg[1] += total
+                        agg[2] = min(agg[2], mn)
+                        agg[3] = max(agg[3], mx)
+        return bins
+
+    def slot(self, t):
+        """Return slot number of time t, or of a chunk's first sample"""
+        if isinstance(t, Chunk):
+            t = t.stats["time"][0]
+        return t // self.slot_period
+
+    def compact(self):
+        """Merge runs of adjacent undersized on-disk chunks in the same slot"""
+        sealed, ends, active = self.manifest
+        run = []
+        for chunk in sealed:
+            small = chunk.cols is None and chunk.count < self.chunk_size
+            fits = len(run) == 0 or (
+                self.slot(chunk) == self.slot(run[0])
+                and sum(c.count for c in run) + chunk.count <= self.chunk_size
+            )
+            if small and fits:
+                run.append(chunk)
+                continue
+            if len(run) > 1:
+                self.merge(run)
+            run = [chunk] if small else []
+        if len(run) > 1:
+            self.merge(run)
+
+    def merge(self, run):
+        """
+        Write chunks in run as one chunk, publish a manifest with the
+        merged chunk in their place, and retire the originals.
+        """
+        merged = Chunk()
+        for chunk in run:
+            start = merged.count
+            merged.sources.append((os.path.basename(chunk.path), start, chunk.count))
+            merged.sources += [(n, start + s, c) for n, s, c in chunk.sources]
+            cols = chunk.load()
+            for name, t in Chunk.columns:
+                merged.cols[name].extend(cols[name])
+                mn, mx = merged.stats[name]
+                cmn, cmx = chunk.stats[name]
+                merged.stats[name] = (min(mn, cmn), max(mx, cmx))
+            merged.count += chunk.count
+        name = "{:.6f}.{:.6f}.chunk".format(*merged.stats["time"])
+        merged.path = os.path.join(self.path, name)
+        merged.write()
+        with self.publish_lock:
+            sealed, ends, active = self.manifest
+            i = sealed.index(run[0])
+            j = i + len(run)
+            self.manifest = (
+                sealed[:i] + (merged,) + sealed[j:],
+                ends[:i] + (merged.stats["time"][1],) + ends[j:],
+                active,
+            )
+
+        def free():
+            for chunk in run:
+                os.unlink(chunk.path)
+
+        self.epochs.retire(free)
+
+
+def scan_chunk(query, chunk):
+    """Process pool worker: scan one chunk"""
+    return query.scan(chunk)
+
+
+class Query:
+    """
+    Ad-hoc filter and aggregate over the sample store.
+
+    where is a list of (column, op, value) predicates, ANDed together,
+    e.g. [("status", "=", 10), ("weight", ">", 900)].  t0/t1 bound the
+    time range, hours=(8, 10) restricts to a local time-of-day window,
+    and group may be "day", "hour", or None.  The column "weight" is
+    aggregated to [count, sum, min, max] per group.
+
+    Chunks are pruned using their min/max statistics before any samples
+    are read.  A chunk that lies within one time window and one group,
+    with predicates only on status and weight ranges, is answered from
+    its status index by bisection.  Otherwise, the sorted time column
+    turns time restrictions into index ranges, each predicate yields a
+    bitmap, and bitmaps are ANDed as integers.  Aggregates are taken
+    over compress(weights, bitmap), or a plain slice if no predicate
+    needed evaluating.
+    """
+
+    ops = {
+        "=": operator.eq,
+        "!=": operator.ne,
+        "<": operator.lt,
+        "<=": operator.le,
+        ">": operator.gt,
+        ">=": operator.ge,
+    }
+
+    def __init__(self, where=(), t0=None, t1=None, hours=None, group=None):
+        self.where = list(where)
+        self.t0 = t0
+        self.t1 = t1
+        self.hours = hours
+        self.group = group
+
+    def never(self, op, v, mn, mx):
+        """Return True if no value in [mn, mx] can satisfy (op, v)"""
+        return {
+            "=": not mn <= v <= mx,
+            "!=": mn == mx == v,
+            "<": mn >= v,
+            "<=": mn > v,
+            ">": mx <= v,
+            ">=": mx < v,
+        }[op]
+
+    def always(self, op, v, mn, mx):
+        """Return True if every value in [mn, mx] satisfies (op, v)"""
+        return {
+            "=": mn == mx == v,
+            "!=": not mn <= v <= mx,
+            "<": mx < v,
+            "<=": mx <= v,
+            ">": mn > v,
+            ">=": mn >= v,
+        }[op]
+
+    def windows(self, lo, hi):
+        """Return list of [start, end) time ranges within [lo, hi] to scan"""
+        a = lo if self.t0 is None else max(lo, self.t0)
+        b = hi + 1 if self.t1 is None else min(hi + 1, self.t1)
+        if a >= b:
+            return []
+        if self.hours is None:
+            return [(a, b)]
+        result = []
+        h0, h1 = self.hours
+        for d in range(date.fromtimestamp(a).toordinal(), date.fromtimestamp(b).toordinal() + 1):
+            tm = date.fromordinal(d).timetuple()
+            start = time.mktime(tm[:3] + (h0, 0, 0, 0, 0, -1))
+            end = time.mktime(tm[:3] + (h1, 0, 0, 0, 0, -1))
+            if max(a, start) < min(b, end):
+                result.append((max(a, start), min(b, end)))
+        return result
+
+    def prune(self, stats):
+        """Return True if chunk statistics show the chunk may have matches"""
+        if len(self.windows(*stats["time"])) == 0:
+            return False
+        return not any(
+            self.never(op, v, *stats[name]) for name, op, v in self.where
+        )
+
+    def groups(self, a, b):
+        """Return list of (key, start) for groups covering [a, b]"""
+        if self.group is None:
+            return [("all", a)]
+        tm = time.localtime(a)
+        if self.group == "day":
+            start = time.mktime(tm[:3] + (0, 0, 0, 0, 0, -1))
+            fmt, step = "%Y-%m-%d", (0, 0, 1, 0)
+        elif self.group == "hour":
+            start = time.mktime(tm[:4] + (0, 0, 0, 0, -1))
+            fmt, step = "%Y-%m-%d %H:00", (0, 0, 0, 1)
+        else:
+            raise ValueError("unknown group '{}'".format(self.group))
+        result = []
+        while start <= b:
+            tm = time.localtime(start)
+            result.append((time.strftime(fmt, tm), start))
+            start = time.mktime(
+                tuple(x + dx for x, dx in zip(tm[:4], step)) + (0, 0, 0, 0, -1)
+            )
+        return result
+
+    def scan(self, chunk):
+        """Scan one chunk, returning {key: [count, sum, min, max]}"""
+        lo, hi = chunk.stats["time"]
+        if self.windows(lo, hi) == [(lo, hi + 1)] and len(self.groups(lo, hi)) == 1:
+            result = self.scan_index(chunk)
+            if result is not None:
+                return result
+        return self.scan_columns(chunk.stats, chunk.load())
+
+    def scan_index(self, chunk):
+        """
+        Aggregate a chunk from its status index, or return None if the
+        predicates can't be answered that way.
+        """
+        ranges = []
+        for name, op, v in self.where:
+            if name == "weight" and op in ("<", "<=", ">", ">=", "="):
+                ranges.append((op, v))
+            elif name != "status":
+                return None
+        agg = None
+        for status, (weights, sums) in chunk.status_index().items():
+            if not all(
+                self.ops[op](status, v) for name, op, v in self.where if name == "status"
+            ):
+                continue
+            i, j = 0, len(weights)
+            for op, v in ranges:
+                if op in (">", ">=", "="):
+                    i = max(i, (bisect_right if op == ">" else bisect_left)(weights, v))
+                if op in ("<", "<=", "="):
+                    j = min(j, (bisect_left if op == "<" else bisect_right)(weights, v))
+            if i < j:
+                part = [j - i, sums[j] - sums[i], weights[i], weights[j - 1]]
+                agg = part if agg is None else self.combine(agg, part)
+        if agg is None:
+            return {}
+        return {self.groups(*chunk.stats["time"])[0][0]: agg}
+
+    def scan_columns(self, stats, cols):
+        """Scan one chunk's columns, returning {key: [count, sum, min, max]}"""
+        times, weights = cols["time"], cols["weight"]
+        result = {}
+        for a, b in self.windows(*stats["time"]):
+            lo, hi = bisect_left(times, a), bisect_left(times, b)
+            if lo == hi:
+                continue
+            mask = None
+            for name, op, v in self.where:
+                if self.always(op, v, *stats[name]):
+                    continue
+                vals = map(self.ops[op], cols[name][lo:hi], repeat(v))
+                m = int.from_bytes(bytes(vals), "little")
+                mask = m if mask is None else mask & m
+            if mask is not None:
+                if mask == 0:
+                    continue
+                mask = mask.to_bytes(hi - lo, "little")
+            groups = self.groups(times[lo], times[hi - 1])
+            for i, (key, start) in enumerate(groups):
+                j = bisect_left(times, start, lo, hi)
+                k = hi
+                if i + 1 < len(groups):
+                    k = bisect_left(times, groups[i + 1][1], lo, hi)
+                vals = weights[j:k]
+                if mask is not None:
+                    vals = list(compress(vals, mask[j - lo : k - lo]))
+                if len(vals) > 0:
+                    self.merge(result, key, [len(vals), sum(vals), min(vals), max(vals)])
+        return result
+
+    def combine(self, r, agg):
+        """Return the combination of aggregates r and agg"""
+        return [r[0] + agg[0], r[1] + agg[1], min(r[2], agg[2]), max(r[3], agg[3])]
+
+    def merge(self, result, key, agg):
+        """Merge aggregate agg into result[key]"""
+        if key not in result:
+            result[key] = agg
+        else:
+            result[key] = self.combine(result[key], agg)
+
+    def run(self, store, workers=None):
+        """
+        Run the query over store, returning {key: [count, sum, min, max]}.
+        Chunks that are only on disk are scanned by a pool of worker
+        processes, one per core by default; the rest are scanned here.
+        """
+        if workers is None:
+            workers = os.cpu_count() or 1
+        with store.snapshot() as snap:
+            # read cols once: the writer thread may drop them at any time
+            chunks = [
+                (c, c.cols)
+                for c in snap.chunks
+                if c.count > 0 and self.prune(c.stats)
+            ]
+            ondisk = [c for c, cols in chunks if cols is None]
+            parts = [self.scan(c) for c, cols in chunks if cols is not None]
+            if workers > 1 and len(ondisk) > workers:
+                with ProcessPoolExecutor(workers) as pool:
+                    size = max(1, len(ondisk) // (workers * 4))
+                    parts += pool.map(scan_chunk, repeat(self), ondisk, chunksize=size)
+            else:
+                parts += map(scan_chunk, repeat(self), ondisk)
+        result = {}
+        for part in parts:
+            for key, agg in part.items():
+                self.merge(result, key, agg)
+        return result
+
+
+def parse_date(value):
+    """Return time of local midnight starting YYYY-MM-DD"""
+    return time.mktime(time.strptime(value, "%Y-%m-%d"))
+
+
+def query_main(args):
+    """
+    Run an ad-hoc query from the command line and print the results, e.g.
+      brewcop.py query status=10 'weight>900' hours=8-10 group=day
+    Besides column predicates, accept from=YYYY-MM-DD, to=YYYY-MM-DD
+    (exclusive), hours=H0-H1, and group=day|hour.
+    """
+    q = Query()
+    for arg in args:
+        m = re.match(r"(\w+)(<=|>=|!=|=|<|>)(.+)$", arg)
+        if not m:
+            sys.exit("brewcop: could not parse '{}'".format(arg))
+        name, op, value = m.groups()
+        if name == "hours":
+            q.hours = tuple(int(h) for h in value.split("-"))
+        elif name == "group":
+            q.group = value
+        elif name == "from":
+            q.t0 = parse_date(value)
+        elif name == "to":
+            q.t1 = parse_date(value)
+        elif name in dict(Chunk.columns):
+            q.where.append((name, op, float(value)))
+        else:
+            sys.exit("brewcop: unknown column '{}'".format(name))
+    store = SampleStore()
+    for key, (count, total, mn, mx) in sorted(q.run(store).items()):
+        print(
+            "{} count={} min={:.0f}g max={:.0f}g mean={:.0f}g".format(
+                key, count, mn, mx, total / count
+            )
+        )
+    store.close()
+
+
+def export_main(args):
+    """
+    Write samples as CSV on stdout from the command line, e.g.
+      brewcop.py export from=2026-10-01 to=2026-10-08
+    The export reads a snapshot, so it never stalls a running brewcop.
+    """
+    t0, t1 = -math.inf, math.inf
+    for arg in args:
+        name, sep, value = arg.partition("=")
+        if name == "from" and sep:
+            t0 = parse_date(value)
+        elif name == "to" and sep:
+            t1 = parse_date(value)
+        else:
+            sys.exit("brewcop: could not parse '{}'".format(arg))
+    store = SampleStore()
+    with store.snapshot() as snap:
+        print("time,weight,status")
+        for chunk in snap.chunks:
+            lo, hi = chunk.stats["time"]
+            if chunk.count == 0 or hi < t0 or lo >= t1:
+                continue
+            cols = chunk.load()
+            times = cols["time"]
+            for i in range(bisect_left(times, t0), bisect_left(times, t1)):
+                print(
+                    "{:.3f},{:.1f},{}".format(
+                        times[i], cols["weight"][i], cols["status"][i]
+                    )
+                )
+    store.close()
+
+
+def journal_main(args):
+    """
+    Summarize the state journal from the command line, e.g.
+      brewcop.py journal from=2026-10-17 to=2026-10-18
+    Print when each state was last entered, and time spent in each state
+    (and stale) over [from, to), which defaults to today so far.
+    """
+    t0 = parse_date(time.strftime("%Y-%m-%d"))
+    t1 = time.time()
+    for arg in args:
+        name, sep, value = arg.partition("=")
+        if name == "from" and sep:
+            t0 = parse_date(value)
+        elif name == "to" and sep:
+            t1 = parse_date(value)
+        else:
+            sys.exit("brewcop: could not parse '{}'".format(arg))
+
+    def hms(secs):
+        return "{:d}:{:02d}:{:02d}".format(
+            int(secs // 3600), int(secs % 3600 // 60), int(secs % 60)
+        )
+
+    journal = Journal()
+    for channel, states in zip(journal.channel_names, journal.channels):
+        for state in states:
+            last = journal.last(state, channel)
+            when = "never"
+            if last is not None:
+                when = time.strftime("%Y-%m-%d %H:%M:%S", time.localtime(last))
+            print(
+                "{:5} {:8} {:>10}  last entered {}".format(
+                    channel,
+                    state,
+                    hms(journal.duration(state, t0, t1, channel)),
+                    when,
+                )
+            )
+    stale = journal.stale(t0, t1, Brewcop.stale_thresh)
+    print("{:5} {:8} {:>10}".format("pot", "stale", hms(stale)))
+    journal.close()
+
+
 class Brains:
     """
     Add some scale memory and semantics for interpreting a series
@@ -335,12 +1559,24 @@ class Brains:
     """Retain scale samples for history_length seconds"""
     history_length = 30
 
-    def __init__(self, tick_period=1, empty_thresh=0, stale_thresh=60 * 60 * 8):
+    def __init__(
+        self, tick_period=1, empty_thresh=0, stale_thresh=60 * 60 * 8, journal=None
+    ):
         self.history = deque(maxlen=int(self.history_length / tick_period))
         self.pot_empty_thresh_g = empty_thresh
         self.stale_thresh = stale_thresh
-        self.state = "unknown"
+        self.journal = journal
+        self.state = None
         self.timestamp = 0
+        self.transition("unknown")
+
+    def transition(self, state):
+        """Enter state if not already there, recording it in the journal"""
+        if self.state != state:
+            self.state = state
+            self.timestamp = time.time()
+            if self.journal:
+                self.journal.append(state, self.timestamp)
 
     def notify(self):
         """Stub for slack notification"""
@@ -361,19 +1597,13 @@ class Brains:
         Call notify() on brewing->ready state transition.
         """
         if self.increasing():
-            if self.state != "brewing":
-                self.state = "brewing"
-                self.timestamp = time.time()
+            self.transition("brewing")
         elif self.history[0] <= self.pot_empty_thresh_g:
-            if self.state != "empty":
-                self.state = "empty"
-                self.timestamp = time.time()
+            self.transition("empty")
         else:
             if self.state == "brewing":  # only notify on brewing->ready
                 self.notify()
-            if self.state != "ready":
-                self.state = "ready"
-                self.timestamp = time.time()
+            self.transition("ready")
 
     def store(self, w):
         """Record a scale measurement"""
@@ -407,6 +1637,283 @@ class Brains:
             return ""
 
 
+class Governor:
+    """
+    Shed UI work when the pi is short of CPU, so scale acquisition keeps
+    its rate.
+
+    Each tick, measure "busy", the CPU time this process (all threads)
+    used over the last tick cycle, and "late", how late the tick fired
+    relative to tick_period.  Busy is not system-wide headroom; CPU taken
+    by other processes shows up as lateness instead.  The larger of the
+    two, as a fraction of the cycle, is smoothed into a pressure value.
+    Pressure above high_water raises the level, below low_water lowers
+    it, with at least hold ticks between changes:
+    0 - full refresh
+    1 - no poll indicator redraw; meter and header every divisor ticks
+    2 - progress bar also every divisor ticks
+    Polling the scale and storing samples are never throttled.  Nor are
+    screen redraws: urwid still redraws after every tick.  Shedding only
+    thins out widget updates, so fewer widgets need rendering, and the
+    poll indicator is only set when its text changes.
+
+    The level and pressure are written to path_metrics when the level
+    changes, and every publish_ticks ticks.
+    """
+
+    path_metrics = os.path.expanduser("~/.brewcop/metrics")
+
+    high_water = 0.6
+    low_water = 0.3
+    hold = 10
+    divisor = 4
+    alpha = 0.2
+    max_level = 2
+    publish_ticks = 120
+
+    def __init__(self, tick_period, path=None):
+        self.path = path or self.path_metrics
+        self.tick_period = tick_period
+        self.level = 0
+        self.pressure = 0.0
+        self.ticks = 0
+        self.changed = 0
+        self.cycle = None
+        self.end = None
+
+    def start(self):
+        """Call at start of tick to update pressure and level"""
+        now, cpu = time.monotonic(), time.process_time()
+        if self.cycle:
+            wall0, cpu0 = self.cycle
+            busy = (cpu - cpu0) / max(now - wall0, 1e-6)
+            late = max(0.0, now - self.end - self.tick_period) / self.tick_period
+            self.pressure += self.alpha * (max(busy, late) - self.pressure)
+        self.cycle = (now, cpu)
+        self.ticks += 1
+        level = self.level
+        if self.ticks - self.changed >= self.hold:
+            if self.pressure > self.high_water and self.level < self.max_level:
+                self.level += 1
+                self.changed = self.ticks
+            elif self.pressure < self.low_water and self.level > 0:
+                self.level -= 1
+                self.changed = self.ticks
+        if self.level != level or self.ticks % self.publish_ticks == 1:
+            self.publish()
+
+    def publish(self):
+        """Write metrics to path_metrics, one "name value" per line"""
+        tmp = self.path + ".tmp"
+        try:
+            with open(tmp, "w") as f:
+                for name, value in self.metrics.items():
+                    f.write("{} {}\n".format(name, value))
+            os.rename(tmp, self.path)
+        except OSError:
+            pass
+
+    def finish(self):
+        """Call at end of tick"""
+        self.end = time.monotonic()
+
+    def due(self, level):
+        """Return True if UI work shed at level should run this tick"""
+        return self.level < level or self.ticks % self.divisor == 0
+
+    @property
+    def metrics(self):
+        """Get governor metrics"""
+        return {
+            "time": round(time.time(), 3),
+            "level": self.level,
+            "pressure": round(self.pressure, 3),
+        }
+
+    @property
+    def display(self):
+        """Get indicator text, empty at full refresh"""
+        if self.level == 0:
+            return ""
+        return ("red", "slow:{}".format(self.level))
+
+
+class History:
+    """
+    Page back through pot level history on the display, a day or a week
+    per page.  Pages are charted from sample store rollups, and kept in
+    a small LRU cache.  When the shown page changes, its neighbours are
+    queued for a prefetch thread to render, so paging is instant.
+    Pages that include the present expire after live_ttl seconds; an
+    expired page is still shown while the prefetch thread re-renders it.
+    The UI thread never renders: a page not yet rendered is shown empty,
+    titled "loading", until the prefetch thread has it.  A page that
+    fails to render says so, and is retried after live_ttl seconds; the
+    error is logged to path_log.
+    """
+
+    path_log = os.path.expanduser("~/.brewcop/history.log")
+
+    width = 72
+    height = 10
+    cache_size = 8
+    live_ttl = 60
+
+    def __init__(self, store, tare_g, capacity_g):
+        self.store = store
+        self.tare_g = tare_g
+        self.capacity_g = capacity_g
+        self.span = 1
+        self.offset = 0
+        self.cache = OrderedDict()
+        self.lock = threading.Lock()
+        self.shown = None
+        self.pending = set()
+        self.queue = queue.Queue()
+        self.prefetcher = threading.Thread(target=self.prefetch_loop, daemon=True)
+        self.prefetcher.start()
+
+    def key(self, offset, span=None):
+        """Return (days, first day number) of page offset pages back"""
+        span = span or self.span
+        today = date.today().toordinal()
+        return (span, today - span + 1 + offset * span)
+
+    def open(self):
+        """
+        Reset to the current page, and queue the current page of the
+        other span so switching between day and week is instant.
+        """
+        self.offset = 0
+        self.shown = None
+        self.request(self.key(0, 7 if self.span == 1 else 1))
+
+    def lookup(self, key):
+        """Return cached page for key, fresh or expired, else None"""
+        with self.lock:
+            page = self.cache.get(key)
+            if page is not None:
+                self.cache.move_to_end(key)
+            return page
+
+    def insert(self, key, page):
+        """Add page to cache, evicting the least recently used"""
+        with self.lock:
+            self.cache[key] = page
+            self.cache.move_to_end(key)
+            while len(self.cache) > self.cache_size:
+                self.cache.popitem(last=False)
+
+    def request(self, key):
+        """Queue key for the prefetch thread, unless already queued"""
+        with self.lock:
+            if key in self.pending:
+                return
+            self.pending.add(key)
+        self.queue.put(key)
+
+    def prefetch_loop(self):
+        """
+        Prefetch thread: render queued pages missing or expired in cache.
+        If rendering fails, log the error and cache a page saying so.
+        """
+        while True:
+            key = self.queue.get()
+            try:
+                page = self.lookup(key)
+                if page is None or page[0] < time.time():
+                    self.insert(key, self.render(key))
+            except Exception as e:
+                self.log(traceback.format_exc())
+                lines = ["render failed: {}".format(e)]
+                self.insert(key, (time.time() + self.live_ttl, self.title(key), lines))
+            finally:
+                with self.lock:
+                    self.pending.discard(key)
+
+    def log(self, text):
+        """Append text to path_log, with a timestamp"""
+        try:
+            with open(self.path_log, "a") as f:
+                f.write(time.strftime("%Y-%m-%d %H:%M:%S ") + text)
+        except OSError:
+            pass
+
+    def page(self):
+        """
+        Return (expiry, title, lines) for the current page.  If it was
+        never rendered, cache an expired, empty page for it; if expired,
+        return it as is.  Either way, have the prefetch thread render
+        it.  Queue its neighbours if the page changed.
+        """
+        key = self.key(self.offset)
+        page = self.lookup(key)
+        if page is None:
+            page = (0, self.title(key) + " (loading)", [""] * (self.height + 1))
+            self.insert(key, page)
+        if page[0] < time.time():
+            self.request(key)
+        if key != self.shown:
+            self.shown = key
+            self.request(self.key(self.offset - 1))
+            if self.offset < 0:
+                self.request(self.key(self.offset + 1))
+        return page
+
+    def bounds(self, key):
+        """Return the [t0, t1) time range of the page for key"""
+        days, first = key
+        t0 = time.mktime(date.fromordinal(first).timetuple())
+        t1 = time.mktime(date.fromordinal(first + days).timetuple())
+        return t0, t1
+
+    def title(self, key):
+        """Return the title of the page for key"""
+        t0, t1 = self.bounds(key)
+        if key[0] == 1:
+            return time.strftime("%a %Y-%m-%d", time.localtime(t0))
+        return "{} - {}".format(
+            time.strftime("%Y-%m-%d", time.localtime(t0)),
+            time.strftime("%Y-%m-%d", time.localtime(t1 - 1)),
+        )
+
+    def render(self, key):
+        """Chart mean pot level per column over the page's days"""
+        days, first = key
+        t0, t1 = self.bounds(key)
+        now = time.time()
+        expiry = now + self.live_ttl if t1 > now else math.inf
+
+        levels = []
+        for count, total, mn, mx in self.store.rollup(t0, t1, self.width):
+            levels.append(total / count - self.tare_g if count > 0 else -1)
+        lines = []
+        for row in range(self.height, 0, -1):
+            thresh = self.capacity_g * (row - 0.5) / self.height
+            if row == self.height:
+                label = "{:4.0f} ".format(self.capacity_g)
+            elif row == 1:
+                label = "   0 "
+            else:
+                label = "     "
+            lines.append(label + "".join("█" if l >= thresh else " " for l in levels))
+
+        if days == 1:
+            marks = [(t0 + h * 3600, "%H:%M") for h in range(0, 24, 6)]
+        else:
+            marks = [
+                (time.mktime(date.fromordinal(first + d).timetuple()), "%a")
+                for d in range(days)
+            ]
+        axis = [" "] * self.width
+        for t, fmt in marks:
+            col = int((t - t0) / (t1 - t0) * self.width)
+            text = time.strftime(fmt, time.localtime(t))
+            axis[col : col + len(text)] = text
+        lines.append("   mL" + "".join(axis[: self.width]))
+        return (expiry, self.title(key) + " (mL)", lines)
+
+
 class Brewcop:
     """
     Main Brewcop class.
@@ -428,12 +1935,21 @@ class Brewcop:
         except:
             self.scale = NoScale()
         self.disp = DisplayHelper(pot_capacity_mL=self.pot_capacity_g)
+        self.store = SampleStore(compact=True)
+        self.journal = Journal()
+        self.journal.recover(self.store.last_time())
         self.brains = Brains(
             tick_period=self.tick_period,
             empty_thresh=self.pot_empty_thresh_g,
             stale_thresh=self.stale_thresh,
+            journal=self.journal,
         )
+        self.governor = Governor(self.tick_period)
+        self.indicator = None
+        self.history = History(self.store, self.pot_tare_g, self.pot_capacity_g)
+        self.history_page = None
         self._online = False
+        self.journal.append("offline")
 
     @property
     def online(self):
@@ -446,55 +1962,120 @@ class Brewcop:
         Set online status (True or False).
         If online, hide the meter and show coffee progress bar.
         If offline, show the meter and replace progress bar with offline msg.
+        Transitions are recorded in the journal.
         """
         if self._online and not value:
             self._online = False
             self.disp.offline()
+            self.journal.append("offline")
         elif not self._online and value:
             self._online = True
             self.disp.online()
+            self.journal.append("online")
 
     def poll_scale(self):
         """
         Poll the current scale value.
-        Pulse the indicator green so we get visual feedback if this is slow.
+        Pulse the indicator green so we get visual feedback if this is slow,
+        unless the governor is shedding UI work.
         The urwid event loop is stalled while this is happening.
         If it fails, leave the indicator red and set the meter value to ----.
         """
-        self.disp.headR = ("green", "poll")
-        self.disp.redraw()
+        if self.governor.level == 0:
+            self.indicate(("green", "poll"))
+            self.disp.redraw()
         try:
             self.scale.poll()
         except:
-            self.disp.headR = ("red", "poll")
+            self.indicate(("red", "poll"))
             self.disp.meter = "----"
         else:
-            self.disp.headR = ""
-            self.disp.meter = self.scale.display
+            self.indicate(self.governor.display)
+            if self.governor.due(1):
+                self.disp.meter = self.scale.display
+            self.store.append(time.time(), self.scale.weight, self.scale.status)
+
+    def indicate(self, value):
+        """
+        Set the poll indicator in the header, if it changed.  Setting
+        text marks the header for rendering even if it is the same.
+        """
+        if value != self.indicator:
+            self.indicator = value
+            self.disp.headR = value
 
     def tick(self):
         """
         urwid's event loop calls this function on tick_period intervals.
         Read the scale, then update the meter and the progress bar.
         Switch online mode depending on weight reading.
+        Display updates are thinned out as the governor's level rises.
         """
+        self.governor.start()
         self.poll_scale()
         if self.scale.weight_is_valid:
             w = self.scale.weight - self.pot_tare_g
             if w < 0:
                 self.online = False
             else:
-                self.disp.progress(w)
+                if self.governor.due(2):
+                    self.disp.progress(w)
                 self.online = True
                 self.brains.store(w)
-        self.disp.headC = self.brains.display
+        if self.governor.due(1):
+            self.disp.headC = self.brains.display
+            if self.disp.history_shown:
+                self.show_history()
+        self.governor.finish()
+
+    def show_history(self):
+        """Show the history browser's current page, if it changed"""
+        page = self.history.page()
+        if page is not self.history_page:
+            self.history_page = page
+            self.disp.history(*page[1:])
+
+    def handle_key(self, key):
+        """
+        Handle history browser keys: h toggles the browser, left/right
+        page back and forward in time, w switches between day and week.
+        """
+        if key == "h" and self.disp.history_shown:
+            self.disp.history_close()
+        elif key == "h":
+            self.history.open()
+            self.history_page = None
+            self.show_history()
+        elif not self.disp.history_shown:
+            return
+        elif key == "left":
+            self.history.offset -= 1
+            self.show_history()
+        elif key == "right" and self.history.offset < 0:
+            self.history.offset += 1
+            self.show_history()
+        elif key == "w":
+            self.history.span = 7 if self.history.span == 1 else 1
+            self.history.offset = 0
+            self.show_history()
 
     def run(self):
         """Enter urwid's event loop.  Start ticker and handle input"""
-        self.disp.run(self.tick, self.tick_period)
-
-
-brewcop = Brewcop()
-brewcop.run()
+        self.disp.run(self.tick, self.tick_period, self.handle_key)
+        self.journal.append("down")
+        self.journal.close()
+        self.store.close()
+
+
+if __name__ == "__main__":
+    if len(sys.argv) > 1 and sys.argv[1] == "query":
+        query_main(sys.argv[2:])
+    elif len(sys.argv) > 1 and sys.argv[1] == "export":
+        export_main(sys.argv[2:])
+    elif len(sys.argv) > 1 and sys.argv[1] == "journal":
+        journal_main(sys.argv[2:])
+    else:
+        brewcop = Brewcop()
+        brewcop.run()
 
 # vim: tabstop=4 shiftwidth=4 expandtab
@@ -0,0 +1,119 @@
+#!/usr/bin/env python3
+
+##############################################################
+#  Copyright 2019 Jim Garlick <garlick.jim@gmail.com>
+#  (c.f. COPYING)
+#
+#  This file is part of BREWCOP, a coffee pot monitor.
+#  For details, see https://github.com/garlick/brewcop.
+#
+#  SPDX-License-Identifier: BSD-3-Clause
+##############################################################
+
+# journal_check.py - check journal interval queries against brute force
+
+# Write a random journal spanning 400 days, with intervals that cross
+# midnight (and DST changes), reload it, and compare Journal.duration()
+# and Journal.stale(), which use the per-day summary blocks, with sums
+# computed directly from the records.  Also check that records appended
+# after a torn final record survive a reload.  Exit nonzero on mismatch.
+#
+# Usage: journal_check.py [queries]
+
+import os
+import random
+import shutil
+import sys
+import tempfile
+import time
+
+sys.path.insert(0, os.path.join(os.path.dirname(__file__), ".."))
+from brewcop import Journal
+
+pot_states = ("brewing", "ready", "empty", "down")
+
+
+def brute(recs, state, t0, t1, offset=0):
+    """Sum time in state over [t0, t1), starting offset into each interval"""
+    total = 0.0
+    now = time.time()
+    for i, (t, s) in enumerate(recs):
+        end = recs[i + 1][0] if i + 1 < len(recs) else now
+        if s == state:
+            total += max(0.0, min(end, t1) - max(t + offset, t0))
+    return total
+
+
+def check(queries):
+    random.seed(42)
+    path = tempfile.mkdtemp(prefix="brewcop-journal.")
+    journal = Journal(os.path.join(path, "journal"))
+    now = time.time()
+    t = now - 400 * 86400
+    recs = []
+    while t < now - 3600:
+        state = random.choice(pot_states)
+        if len(recs) == 0 or recs[-1][1] != state:
+            journal.append(state, t)
+            recs.append((t, state))
+        t += random.uniform(100, 40000)
+    journal.close()
+
+    journal = Journal(os.path.join(path, "journal"))
+    failed = 0
+    for i in range(queries):
+        t0 = random.uniform(now - 420 * 86400, now)
+        t1 = random.uniform(t0, now + 100)
+        expect = [brute(recs, s, t0, t1) for s in pot_states]
+        expect.append(brute(recs, "ready", t0, t1, offset=4 * 3600))
+        got = [journal.duration(s, t0, t1) for s in pot_states]
+        got.append(journal.stale(t0, t1, 4 * 3600))
+        for name, e, g in zip(pot_states + ("stale",), expect, got):
+            if abs(e - g) > 1e-3 * max(1.0, e):
+                print("{} [{}, {}): expected {} got {}".format(name, t0, t1, e, g))
+                failed += 1
+    journal.close()
+    shutil.rmtree(path)
+
+    t0 = time.perf_counter()
+    for i in range(1000):
+        journal.duration("ready", now - 365 * 86400, now)
+    print(
+        "{} records, {} queries, {} failed, {:.1f}us per year query".format(
+            len(recs), queries, failed, (time.perf_counter() - t0) * 1e3
+        )
+    )
+    return failed
+
+
+def check_torn():
+    """Append after a torn record, as after an unclean exit, and reload"""
+    path = tempfile.mkdtemp(prefix="brewcop-journal.")
+    name = os.path.join(path, "journal")
+    now = time.time()
+    journal = Journal(name)
+    journal.append("brewing", now - 300)
+    journal.append("ready", now - 200)
+    journal.close()
+    with open(name, "ab") as f:
+        f.write(b"\0" * 4)
+    journal = Journal(name)
+    journal.append("empty", now - 100)
+    journal.append("brewing", now - 50)
+    journal.close()
+    journal = Journal(name)
+    got = [journal.last(s) for s in ("brewing", "ready", "empty")]
+    journal.close()
+    shutil.rmtree(path)
+    if got != [now - 50, now - 200, now - 100]:
+        print("torn record: expected records after it, got {}".format(got))
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    queries = int(sys.argv[1]) if len(sys.argv) > 1 else 500
+    failed = check(queries) + check_torn()
+    sys.exit(1 if failed else 0)
+
+# vim: tabstop=4 shiftwidth=4 expandtab
@@ -0,0 +1,172 @@
+#!/usr/bin/env python3
+
+##############################################################
+#  Copyright 2019 Jim Garlick <garlick.jim@gmail.com>
+#  (c.f. COPYING)
+#
+#  This file is part of BREWCOP, a coffee pot monitor.
+#  For details, see https://github.com/garlick/brewcop.
+#
+#  SPDX-License-Identifier: BSD-3-Clause
+##############################################################
+
+# query_check.py - check sample store queries against brute force
+
+# Write a random sample store spanning 20 days, with some samples still
+# in memory, and compare Query.run() with aggregates computed directly
+# from the samples, over random predicates, time-of-day windows and
+# groupings.  Each query is run in this process, where chunks are
+# answered from their status index or their columns, and again with a
+# pool of worker processes.  Exit nonzero on mismatch, or if either
+# scan path or the pool went unused.
+#
+# Usage: query_check.py [queries]
+
+import os
+import random
+import shutil
+import sys
+import tempfile
+import time
+from array import array
+
+sys.path.insert(0, os.path.join(os.path.dirname(__file__), ".."))
+from brewcop import Query, SampleStore
+
+keys = {
+    None: lambda tm: "all",
+    "day": lambda tm: time.strftime("%Y-%m-%d", tm),
+    "hour": lambda tm: time.strftime("%Y-%m-%d %H:00", tm),
+}
+
+
+def brute(samples, query):
+    """Aggregate weight over samples matching query, by group"""
+    result = {}
+    for sample in samples:
+        t, weight = sample["time"], sample["weight"]
+        tm = time.localtime(t)
+        if query.hours and not query.hours[0] <= tm.tm_hour < query.hours[1]:
+            continue
+        if query.t0 is not None and t < query.t0:
+            continue
+        if query.t1 is not None and t >= query.t1:
+            continue
+        if not all(Query.ops[op](sample[name], v) for name, op, v in query.where):
+            continue
+        agg = result.setdefault(keys[query.group](tm), [0, 0.0, weight, weight])
+        agg[0] += 1
+        agg[1] += weight
+        agg[2] = min(agg[2], weight)
+        agg[3] = max(agg[3], weight)
+    return result
+
+
+def same(got, expect):
+    """Return True if query results agree, allowing for summation order"""
+    if got.keys() != expect.keys():
+        return False
+    for key, e in expect.items():
+        g = got[key]
+        if g[0] != e[0] or g[2] != e[2] or g[3] != e[3]:
+            return False
+        if abs(g[1] - e[1]) > 1e-6 * abs(e[1]) + 1e-2:
+            return False
+    return True
+
+
+def random_query(now):
+    """Return a random Query"""
+    where = []
+    ops = list(Query.ops)
+    if random.random() < 0.6:
+        where.append(("status", random.choice(ops), random.choice([0, 10, 11, 20])))
+    for i in range(random.randint(0, 2)):
+        weight = random.choice([0, 450.5, 900, 1300])
+        where.append(("weight", random.choice(ops), weight))
+    return Query(
+        where,
+        t0=random.choice([None, now - 10 * 86400]),
+        hours=random.choice([None, (8, 10), (0, 24)]),
+        group=random.choice([None, "day", "hour"]),
+    )
+
+
+def check(queries):
+    random.seed(42)
+    path = tempfile.mkdtemp(prefix="brewcop-query.")
+    store = SampleStore(path)
+    store.chunk_size = 500
+    now = time.time()
+    t = now - 20 * 86400
+    samples = []
+
+    def append(n):
+        nonlocal t
+        for i in range(n):
+            t += random.uniform(1, 60)
+            weight = array("f", [random.uniform(-5, 1300)])[0]
+            status = random.choice([0, 1, 2, 10, 11, 20, 126])
+            store.append(t, weight, status)
+            samples.append({"time": t, "weight": weight, "status": status})
+
+    append(30000)
+    store.close()
+    store = SampleStore(path)
+    store.chunk_size = 500
+    append(300)  # leave some in memory
+
+    used = {"scan_index": 0, "scan_columns": 0, "pool": 0}
+    for name in ("scan_index", "scan_columns"):
+        method = getattr(Query, name)
+
+        def counted(self, *args, name=name, method=method):
+            used[name] += 1
+            return method(self, *args)
+
+        setattr(Query, name, counted)
+
+    failed = 0
+    elapsed = [0.0, 0.0]
+    for i in range(queries):
+        query = random_query(now)
+        expect = brute(samples, query)
+        for j, workers in enumerate((1, 2)):
+            t0 = time.perf_counter()
+            got = query.run(store, workers)
+            elapsed[j] += time.perf_counter() - t0
+            if not same(got, expect):
+                print(
+                    "{} group={} hours={} workers={}: expected {} got {}".format(
+                        query.where, query.group, query.hours, workers, expect, got
+                    )
+                )
+                failed += 1
+        with store.snapshot() as snap:
+            chunks = [c for c in snap.chunks if c.cols is None and query.prune(c.stats)]
+            if len(chunks) > 2:  # Query.run's condition for using the pool
+                used["pool"] += 1
+    store.close()
+    shutil.rmtree(path)
+
+    for name, n in used.items():
+        if n == 0:
+            print("{} was never used".format(name))
+            failed += 1
+    print(
+        "{} samples, {} queries, {} failed, {:.0f}ms per query, {:.0f}ms pooled".format(
+            len(samples),
+            queries,
+            failed,
+            elapsed[0] / queries * 1e3,
+            elapsed[1] / queries * 1e3,
+        )
+    )
+    return failed
+
+
+if __name__ == "__main__":
+    queries = int(sys.argv[1]) if len(sys.argv) > 1 else 40
+    sys.exit(1 if check(queries) else 0)
+
+# vim: tabstop=4 shiftwidth=4 expandtab
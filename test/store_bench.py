@@ -0,0 +1,182 @@
+#!/usr/bin/env python3
+
+##############################################################
+#  Copyright 2019 Jim Garlick <garlick.jim@gmail.com>
+#  (c.f. COPYING)
+#
+#  This file is part of BREWCOP, a coffee pot monitor.
+#  For details, see https://github.com/garlick/brewcop.
+#
+#  SPDX-License-Identifier: BSD-3-Clause
+##############################################################
+
+# store_bench.py - sample store ingest with and without concurrent readers
+
+# Append samples into a scratch store, first alone, then while readers
+# run queries and exports over snapshots and the compactor merges chunks
+# underneath them.  Readers run as threads in the appending process, like
+# the history browser, and then as separate processes, like the query and
+# export commands.  For each case, report throughput appending flat out,
+# and latency appending at a fixed rate (far above the 2 Hz tick).
+#
+# Readers compete with the appender for CPU, so flat-out throughput
+# drops when they run, all the more with fewer cores.  That the appender
+# is not blocked by readers is shown by the paced latency: p99 and max
+# should stay well under the tick period with readers running.  The run
+# fails if a reader raises.
+#
+# Usage: store_bench.py [seconds] [rate] [readers]
+
+import multiprocessing
+import os
+import random
+import shutil
+import sys
+import tempfile
+import threading
+import time
+import traceback
+
+sys.path.insert(0, os.path.join(os.path.dirname(__file__), ".."))
+from brewcop import Query, SampleStore
+
+
+def ingest(store, seconds, rate=None):
+    """
+    Append for seconds, paced at rate, or flat out if rate is None.
+    Sample times continue from the store's last sample, so they never
+    go backwards, however far ahead of the clock flat out runs them.
+    Return (samples per second, p99 latency, max latency).
+    """
+    lat = []
+    period = 1.0 / rate if rate else 0.0005
+    start = deadline = time.monotonic()
+    t = max(time.time(), store.last_time(), store.active.stats["time"][1])
+    while deadline - start < seconds:
+        t += period
+        t0 = time.perf_counter()
+        store.append(t, random.uniform(700, 1300), random.choice([0, 10, 20]))
+        if len(lat) % 500 == 499:
+            store.seal()  # leave undersized chunks for the compactor
+        lat.append(time.perf_counter() - t0)
+        if rate:
+            deadline += period
+            delay = deadline - time.monotonic()
+            if delay > 0:
+                time.sleep(delay)
+        else:
+            deadline = time.monotonic()
+    lat.sort()
+    return (
+        len(lat) / (time.monotonic() - start),
+        lat[int(len(lat) * 0.99)],
+        lat[-1],
+    )
+
+
+def scan(store):
+    """Run a full-history query and export over store"""
+    q = Query([("status", "=", 10), ("weight", ">", 900)], group="hour")
+    q.run(store, workers=1)
+    with store.snapshot() as snap:
+        for chunk in snap.chunks:
+            sum(chunk.load()["weight"])
+
+
+def thread_reader(store, stop, scans, errors):
+    """Scan the appender's store until stop is set"""
+    try:
+        while not stop.is_set():
+            scan(store)
+            with scans.get_lock():
+                scans.value += 1
+    except Exception:
+        traceback.print_exc()
+        with errors.get_lock():
+            errors.value += 1
+
+
+def process_reader(path, stop, scans, errors):
+    """Scan a fresh view of the store directory until stop is set"""
+    try:
+        while not stop.is_set():
+            store = SampleStore(path)
+            scan(store)
+            store.close()
+            with scans.get_lock():
+                scans.value += 1
+    except Exception:
+        traceback.print_exc()
+        with errors.get_lock():
+            errors.value += 1
+
+
+def measure(store, label, seconds, rate, start_readers=None):
+    """
+    Print throughput and paced latency, with readers running if given.
+    Exit if a reader failed.
+    """
+    stop = multiprocessing.Event()
+    scans = multiprocessing.Value("i", 0)
+    errors = multiprocessing.Value("i", 0)
+    readers = start_readers(stop, scans, errors) if start_readers else []
+    for r in readers:
+        r.start()
+    flat = ingest(store, seconds)
+    paced = ingest(store, seconds, rate)
+    stop.set()
+    for r in readers:
+        r.join()
+    print(
+        "{:9} flat out {:7.0f}/s   at {:.0f}/s: p99 {:.3f}ms max {:.3f}ms"
+        "   ({} scans)".format(
+            label, flat[0], rate, paced[1] * 1e3, paced[2] * 1e3, scans.value
+        )
+    )
+    if errors.value > 0:
+        sys.exit("{}: {} readers failed".format(label, errors.value))
+
+
+def run(seconds, rate, nreaders):
+    path = tempfile.mkdtemp(prefix="brewcop-bench.")
+    SampleStore.compact_period = 0.5
+    store = SampleStore(path, compact=True)
+    store.chunk_size = 2000
+    store.epochs.grace = 0
+    ingest(store, seconds, rate)  # history for readers to scan
+
+    measure(store, "alone", seconds, rate)
+    measure(
+        store,
+        "threads",
+        seconds,
+        rate,
+        lambda stop, scans, errors: [
+            threading.Thread(target=thread_reader, args=(store, stop, scans, errors))
+            for i in range(nreaders)
+        ],
+    )
+    measure(
+        store,
+        "processes",
+        seconds,
+        rate,
+        lambda stop, scans, errors: [
+            multiprocessing.Process(
+                target=process_reader, args=(path, stop, scans, errors)
+            )
+            for i in range(nreaders)
+        ],
+    )
+
+    store.close()
+    shutil.rmtree(path)
+
+
+if __name__ == "__main__":
+    args = [float(a) for a in sys.argv[1:]]
+    args += [5, 1000, 2][len(args):]
+    print("{} cpus, {} readers".format(os.cpu_count(), int(args[2])))
+    run(args[0], args[1], int(args[2]))
+
+# vim: tabstop=4 shiftwidth=4 expandtab